@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Kept free of Arduino dependencies so the native test env can build it on the host.
+
+#define LEDC_CHANNEL_COUNT 16
+
+// Fixture description: one GPIO per light channel, channel i is driven by LEDC channel i.
+// The order of the pins is the order of the channel bytes in light programs and the light state.
+template <uint8_t... Pins>
+struct ChannelSet {
+  static constexpr size_t size = sizeof...(Pins);
+  static constexpr std::array<uint8_t, size> pins = {Pins...};
+
+  static_assert(size >= 1, "Fixture needs at least one channel");
+  static_assert(size <= LEDC_CHANNEL_COUNT, "Fixture can't have more channels than LEDC provides");
+};
+
+template <typename Set>
+using ChannelsOf = std::array<uint8_t, Set::size>;
+
+using CCTFixture = ChannelSet<16, 17>;                   // CW, WW
+using RGBFixture = ChannelSet<16, 17, 18>;               // R, G, B
+using RGBWCCTFixture = ChannelSet<16, 17, 18, 19, 21>;  // R, G, B, CW, WW
+
+// The app currently always sends 2 channel bytes (CW, WW), so only the CCTFixture works with it.
+// Other fixtures need a client that reads the channel count characteristic first.
+using Fixture = CCTFixture;
+
+constexpr size_t CHANNEL_COUNT = Fixture::size;
+using LightChannels = ChannelsOf<Fixture>;
+
+// Blend weights are fixed point with BLEND_SHIFT fractional bits, BLEND_ONE is a weight of 1.0
+constexpr uint32_t BLEND_SHIFT = 16;
+constexpr uint32_t BLEND_ONE = 1u << BLEND_SHIFT;
+
+constexpr LightChannels filledChannels(uint8_t value) {
+  LightChannels channels{};
+  for (auto& channel : channels) {
+    channel = value;
+  }
+  return channels;
+}
+
+// Blends every channel of from towards to in one pass. weight is in [0, BLEND_ONE].
+// The weight is computed once per frame by the caller, so each channel costs one multiply and one shift.
+template <size_t N>
+void blendChannels(const std::array<uint8_t, N>& from, const std::array<uint8_t, N>& to, uint32_t weight,
+                   std::array<uint8_t, N>& out) {
+  const auto w = static_cast<int32_t>(weight);
+  for (size_t i = 0; i < N; ++i) {
+    const int32_t diff = static_cast<int32_t>(to[i]) - from[i];
+    out[i] = static_cast<uint8_t>(from[i] + ((diff * w) >> BLEND_SHIFT));
+  }
+}
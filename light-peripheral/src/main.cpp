@@ -5,6 +5,7 @@
 #include <esp_timer.h>
 #include <sys/time.h>
 
+#include <array>
 #include <chrono>
 #include <cstring>
 #include <ctime>
@@ -12,19 +13,17 @@
 #include <variant>
 #include <vector>
 
+#include "LightChannels.h"
+
 #define SERVICE_UUID "b53e36d0-a21b-47b2-abac-343f523ff4d5"
 #define ADD_LIGHT_PROGRAM_CHARACTERISTIC_UUID "a14af994-2a22-4762-b9e5-cb17a716645c" // W = App writes to it
 #define LIGHT_PROGRAMS_CHARACTERISTIC_UUID "265b9c95-a99d-4477-99dd-fef48fa26004"
 #define LIGHT_STATE_CHARACTERISTIC_UUID "3c95cda9-7bde-471d-9c2b-ac0364befa78"
 #define TIMESTAMP_CHARACTERISTIC_UUID "ab110e08-d3bb-4c8c-87a7-51d7076218cf"
+#define CHANNEL_COUNT_CHARACTERISTIC_UUID "79e5f5fd-a90f-400a-8afe-ed96c168e97f" // R = App reads the length of Channels from it
 
 #define TIMESTAMP_SIZE 8
 
-#define CW_PIN 16
-#define WW_PIN 17
-
-#define PWM_CHANNEL_CW 0
-#define PWM_CHANNEL_WW 1
 #define PWM_FREQUENCY 100  // 1 kHz
 #define PWM_RESOLUTION 8   // 8-bit resolution
 
@@ -32,6 +31,7 @@ BLECharacteristic* pAddLightProgramCharacteristic;
 BLECharacteristic* pLightProgramsCharacteristic;
 BLECharacteristic* pLightStateCharacteristic;
 BLECharacteristic* pTimestampCharacteristic;
+BLECharacteristic* pChannelCountCharacteristic;
 
 BLEAdvertising* pAdvertising;
 
@@ -39,6 +39,7 @@ BLEUUID addLightProgramsUuid = BLEUUID(ADD_LIGHT_PROGRAM_CHARACTERISTIC_UUID);
 BLEUUID lightProgramsUuid = BLEUUID(LIGHT_PROGRAMS_CHARACTERISTIC_UUID);
 BLEUUID lightStateUuid = BLEUUID(LIGHT_STATE_CHARACTERISTIC_UUID);
 BLEUUID timestampUuid = BLEUUID(TIMESTAMP_CHARACTERISTIC_UUID);
+BLEUUID channelCountUuid = BLEUUID(CHANNEL_COUNT_CHARACTERISTIC_UUID);
 
 #define DEBUG_LEVEL 4
 
@@ -127,55 +128,59 @@ void setCurrentTime(time_t timestamp) {
   settimeofday(&tv, nullptr);
 }
 
-std::pair<uint8_t, uint8_t> getLight() {
+String channelsToString(const LightChannels& channels) {
+  String result;
+  for (size_t i = 0; i < CHANNEL_COUNT; ++i) {
+    if (i) result += " ";
+    result += String(channels[i]);
+  }
+  return result;
+}
+
+LightChannels lastChannels{};
+
+LightChannels getLight() {
   if (pLightStateCharacteristic == nullptr) {
     logError("pLightStateCharacteristic is nullptr");
-    return std::pair(0, 0);
+    return {};
   }
 
   const auto& value = pLightStateCharacteristic->getValue();
-  if (value.size() < 2) {
-    logError("Got too small vector for conversion.");
-    return std::pair(0, 0);
+  if (value.size() != CHANNEL_COUNT) {
+    logError("LightState has " + String(value.size()) + " channels, expected " + String(CHANNEL_COUNT) + ". Keeping current light.");
+    return lastChannels;
   }
 
-  return std::pair(value[0], value[1]);
+  LightChannels channels;
+  std::memcpy(channels.data(), value.data(), CHANNEL_COUNT);
+  return channels;
 }
 
-int last_cw = 0;
-int last_ww = 0;
-int lastupdate = 0;
 void updateLight() {
-  auto [cw, ww] = getLight();
+  auto channels = getLight();
 
-  if (last_cw == cw && last_ww == ww) {
+  if (lastChannels == channels) {
     return;
   }
-  logInfo("Updating light to: " + String(cw) + " " + String(ww));
+  logInfo("Updating light to: " + channelsToString(channels));
 
-  if (last_cw != cw) {
-    // reason for the following is the same as this: https://github.com/espressif/arduino-esp32/issues/689#issuecomment-565153280 ...
-    if (cw) {
-      ledcWrite(PWM_CHANNEL_CW, cw);
-    } else {
-      ledcAttachPin(CW_PIN, PWM_CHANNEL_CW);
+  for (size_t i = 0; i < CHANNEL_COUNT; ++i) {
+    if (lastChannels[i] == channels[i]) {
+      continue;
     }
-    last_cw = cw;
-  }
-  if (last_ww != ww) {
-    if (ww) {
-      ledcWrite(PWM_CHANNEL_WW, ww);
+    // reason for the following is the same as this: https://github.com/espressif/arduino-esp32/issues/689#issuecomment-565153280 ...
+    if (channels[i]) {
+      ledcWrite(i, channels[i]);
     } else {
-      ledcAttachPin(WW_PIN, PWM_CHANNEL_WW);
+      ledcAttachPin(Fixture::pins[i], i);
     }
-    last_ww = ww;
   }
+  lastChannels = channels;
   // delay to avoid flickering
 }
 
-void setLight(uint8_t cw, uint8_t ww) {
-  std::array<uint8_t, 2> colorValues = {cw, ww};
-  pLightStateCharacteristic->setValue(&colorValues[0], 2);
+void setLight(const LightChannels& channels) {
+  pLightStateCharacteristic->setValue(const_cast<uint8_t*>(channels.data()), CHANNEL_COUNT);
   pLightStateCharacteristic->notify();
   updateLight();
 }
@@ -185,24 +190,24 @@ void setLight(uint8_t cw, uint8_t ww) {
  LightProgram - Array of Program elements with types (variable Size, see below):
 Every light program is defined by a byte array.
 The Header is always one byte with the TYPE of the light program. Keep in mind MTU of BLE.
-    0x00: Fixed -> body size 10 bytes
+Channels: CHANNEL_COUNT Bytes (one uint value per channel, in the order of the Fixture pins,
+          e.g. CW, WW for the CCTFixture). The light state characteristic holds the same layout.
+          CHANNEL_COUNT can be read as a single byte from the channel count characteristic.
+          Programs or light states of a different length are rejected.
+    0x00: Fixed -> body size 8 + CHANNEL_COUNT bytes
         duration: 8 Bytes (long value in milliseconds)
-        CW: 1 Byte (uint value)
-        WW: 1 Byte (uint value)
-    0x01: Ramp -> body size 10 bytes, will reach target lightState in Duration milliseconds
+        channels: Channels
+    0x01: Ramp -> body size 8 + CHANNEL_COUNT bytes, will reach target lightState in Duration milliseconds
                   in a linear way from the current lightState
         duration: 8 Bytes (long value in milliseconds)
-        CW_target: 1 Byte (uint value)
-        WW_target: 1 Byte (uint value)
-    0x02: Blink -> body size 16 bytes, will blink for duration milliseconds with
+        target: Channels
+    0x02: Blink -> body size 12 + 2 * CHANNEL_COUNT bytes, will blink for duration milliseconds with
                    high_duration milliseconds on high and low_duration on low each interval
         blink_duration: 8 Bytes (long value in milliseconds)
         high_duration: 2 Bytes (ushort value in milliseconds)
         low_duration: 2 Bytes (ushort value in milliseconds)
-        CW_high: 1 Byte (uint value)
-        WW_high: 1 Byte (uint value)
-        CW_low: 1 Byte (uint value)
-        WW_low: 1 Byte (uint value)
+        high: Channels
+        low: Channels
  */
 
 enum class LightProgramType : uint16_t {
@@ -220,39 +225,46 @@ LightProgramType toLightProgramType(unsigned short value) {
   return static_cast<LightProgramType>(value);
 };
 
+size_t actionBodySize(LightProgramType type) {
+  switch (type) {
+    case LightProgramType::FIXED:
+    case LightProgramType::RAMP:
+      return sizeof(uint64_t) + CHANNEL_COUNT;
+    case LightProgramType::BLINK:
+      return sizeof(uint64_t) + 2 * sizeof(uint16_t) + 2 * CHANNEL_COUNT;
+  }
+  return 0;
+}
+
 struct LightActionFixed {
   uint64_t durationMs;
-  uint8_t CW;
-  uint8_t WW;
+  LightChannels channels;
 
-  LightActionFixed(uint64_t durationMs, uint8_t CW, uint8_t WW)
-      : durationMs(durationMs), CW(CW), WW(WW) {
+  LightActionFixed(uint64_t durationMs, const LightChannels& channels)
+      : durationMs(durationMs), channels(channels) {
   }
 
   static LightActionFixed popFromBytes(std::vector<uint8_t>& bytes) {
     auto duration = popValFront<uint64_t>(bytes);
-    auto CW = popValFront<uint8_t>(bytes);
-    auto WW = popValFront<uint8_t>(bytes);
-    return {duration, CW, WW};
+    auto channels = popValFront<LightChannels>(bytes);
+    return {duration, channels};
   }
 };
 
 struct LightActionRamp {
   uint64_t durationMs = 30000;
-  uint8_t targetCW = 255;
-  uint8_t targetWW = 255;
+  LightChannels target = filledChannels(255);
 
-  LightActionRamp(uint64_t durationMs, uint8_t targetCW, uint8_t targetWW)
-      : durationMs(durationMs), targetCW(targetCW), targetWW(targetWW) {
+  LightActionRamp(uint64_t durationMs, const LightChannels& target)
+      : durationMs(durationMs), target(target) {
   }
 
   LightActionRamp() = default;
 
   static LightActionRamp popFromBytes(std::vector<uint8_t>& bytes) {
     auto duration = popValFront<uint64_t>(bytes);
-    auto targetCW = popValFront<uint8_t>(bytes);
-    auto targetWW = popValFront<uint8_t>(bytes);
-    return {duration, targetCW, targetWW};
+    auto target = popValFront<LightChannels>(bytes);
+    return {duration, target};
   }
 };
 
@@ -260,37 +272,29 @@ struct LightActionBlink {
   uint64_t blinkDurationMs;
   uint16_t lowDurationMs;
   uint16_t highDurationMs;
-  uint8_t lowCW;
-  uint8_t lowWW;
-  uint8_t highCW;
-  uint8_t highWW;
+  LightChannels low;
+  LightChannels high;
 
   LightActionBlink(
       uint64_t blinkDurationMs,
       uint16_t lowDurationMs,
       uint16_t highDurationMs,
-      uint8_t lowCW,
-      uint8_t lowWW,
-      uint8_t highCW,
-      uint8_t highWW)
+      const LightChannels& low,
+      const LightChannels& high)
       : blinkDurationMs(blinkDurationMs),
         lowDurationMs(lowDurationMs),
         highDurationMs(highDurationMs),
-        lowCW(lowCW),
-        lowWW(lowWW),
-        highCW(highCW),
-        highWW(highWW) {
+        low(low),
+        high(high) {
   }
 
   static LightActionBlink popFromBytes(std::vector<uint8_t>& bytes) {
     auto blinkDuration = popValFront<uint64_t>(bytes);
-    auto lowDuration = popValFront<uint16_t>(bytes);
     auto highDuration = popValFront<uint16_t>(bytes);
-    auto lowCW = popValFront<uint8_t>(bytes);
-    auto lowWW = popValFront<uint8_t>(bytes);
-    auto highCW = popValFront<uint8_t>(bytes);
-    auto highWW = popValFront<uint8_t>(bytes);
-    return {blinkDuration, lowDuration, highDuration, lowCW, lowWW, highCW, highWW};
+    auto lowDuration = popValFront<uint16_t>(bytes);
+    auto high = popValFront<LightChannels>(bytes);
+    auto low = popValFront<LightChannels>(bytes);
+    return {blinkDuration, lowDuration, highDuration, low, high};
   };
 };
 
@@ -358,21 +362,19 @@ bool operator==(const Schedule& lhs, const Schedule& rhs) {
 }
 
 bool operator==(const LightActionFixed& lhs, const LightActionFixed& rhs) {
-  return lhs.durationMs == rhs.durationMs && lhs.CW == rhs.CW && lhs.WW == rhs.WW;
+  return lhs.durationMs == rhs.durationMs && lhs.channels == rhs.channels;
 }
 
 bool operator==(const LightActionRamp& lhs, const LightActionRamp& rhs) {
-  return lhs.durationMs == rhs.durationMs && lhs.targetCW == rhs.targetCW && lhs.targetWW == rhs.targetWW;
+  return lhs.durationMs == rhs.durationMs && lhs.target == rhs.target;
 }
 
 bool operator==(const LightActionBlink& lhs, const LightActionBlink& rhs) {
   return lhs.blinkDurationMs == rhs.blinkDurationMs &&
          lhs.lowDurationMs == rhs.lowDurationMs &&
          lhs.highDurationMs == rhs.highDurationMs &&
-         lhs.lowCW == rhs.lowCW &&
-         lhs.lowWW == rhs.lowWW &&
-         lhs.highCW == rhs.highCW &&
-         lhs.highWW == rhs.highWW;
+         lhs.low == rhs.low &&
+         lhs.high == rhs.high;
 }
 
 bool operator==(const LightProgramAction& lhs, const LightProgramAction& rhs) {
@@ -398,6 +400,10 @@ class AddLightProgramCharacteristicHandler final : public BLECharacteristicCallb
     std::vector<uint8_t> originalLightProgramBytes(lightProgramBytes);
 
     hexPrint(lightProgramBytes);
+    if (lightProgramBytes.size() < TIMESTAMP_SIZE) {
+      logError("LightProgram is too short for a timestamp, aborting.");
+      return;
+    }
     auto timestamp = static_cast<time_t>(popValFront<uint64_t>(lightProgramBytes));
 
     logInfo("Adding lightProgram at " + getLocalTime(timestamp));
@@ -407,6 +413,14 @@ class AddLightProgramCharacteristicHandler final : public BLECharacteristicCallb
       auto type = popValFront<uint8_t>(lightProgramBytes);
 
       Serial.printf("Found new Element with type %d\n", type);
+      if (type > static_cast<uint8_t>(LightProgramType::BLINK)) {
+        logError("Invalid LightProgram type " + String(type) + ", aborting.");
+        return;
+      }
+      if (lightProgramBytes.size() < actionBodySize(toLightProgramType(type))) {
+        logError("LightProgram action of type " + String(type) + " is too short for " + String(CHANNEL_COUNT) + " channels, aborting.");
+        return;
+      }
       switch (toLightProgramType(type)) {
         case LightProgramType::FIXED:
           lightProgram.actions.emplace_back(LightActionFixed::popFromBytes(lightProgramBytes));
@@ -455,6 +469,11 @@ class LightProgramsCharacteristicHandler final : public BLECharacteristicCallbac
 
 class LightStateCharacteristicHandler : public BLECharacteristicCallbacks {
   void onWrite(BLECharacteristic* pCharacteristic) override {
+    if (pCharacteristic->getLength() != CHANNEL_COUNT) {
+      logError("LightState written with " + String(pCharacteristic->getLength()) + " channels, expected " + String(CHANNEL_COUNT) + ". Ignoring.");
+      pCharacteristic->setValue(lastChannels.data(), CHANNEL_COUNT);
+      return;
+    }
     // Light flickers when updating too often. Use active waiting in main loop if too flickery
     updateLight();
     // Serial.println("LightState written.");
@@ -511,9 +530,9 @@ void printAction(const LightProgramAction& action) {
   std::visit([](const auto& action) {
     using T = std::decay_t<decltype(action)>;
     if constexpr (std::is_same_v<T, LightActionFixed>) {
-      Serial.printf("Fixed action - %d %d with duration %lums\n", action.CW, action.WW, action.durationMs);
+      Serial.printf("Fixed action - %s with duration %lums\n", channelsToString(action.channels).c_str(), action.durationMs);
     } else if constexpr (std::is_same_v<T, LightActionRamp>) {
-      Serial.printf("Ramp action - %d %d with duration %lums\n", action.targetCW, action.targetWW, action.durationMs);
+      Serial.printf("Ramp action - %s with duration %lums\n", channelsToString(action.target).c_str(), action.durationMs);
     } else if constexpr (std::is_same_v<T, LightActionBlink>) {
       Serial.printf("Blink action - %dms on, %dms off with duration %lums\n", action.highDurationMs, action.lowDurationMs, action.blinkDurationMs);
     }
@@ -528,38 +547,36 @@ void executeLightProgram(LightProgram lightProgram) {
       printAction(action);
       using T = std::decay_t<decltype(action)>;
       if constexpr (std::is_same_v<T, LightActionFixed>) {
-        setLight(action.CW, action.WW);
+        setLight(action.channels);
         delay(action.durationMs);
       } else if constexpr (std::is_same_v<T, LightActionRamp>) {
         uint64_t start_usec = getCurrentUsecUTC();
-        uint64_t now_usec, progress_usec;
-        double progress_percent;
-        auto [startCW, startWW] = getLight();
-        auto diffCW = action.targetCW - startCW;
-        auto diffWW = action.targetWW - startWW;
-        uint8_t newCW, newWW;
-        uint64_t rampDurationUsec = action.durationMs *1000;
+        uint64_t progress_usec;
+        uint32_t weight;
+        const auto start = getLight();
+        LightChannels frame;
+        uint64_t rampDurationUsec = action.durationMs * 1000;
 
         do {
-          now_usec = getCurrentUsecUTC();
-          progress_usec = now_usec - start_usec;
-          progress_percent = static_cast<double>(progress_usec) / (action.durationMs * 1000);
-          newCW = startCW + progress_percent * diffCW;
-          newWW = startWW + progress_percent * diffWW;
-          setLight(newCW, newWW);
-        } while (progress_usec < rampDurationUsec && progress_percent >= 0);
+          progress_usec = getCurrentUsecUTC() - start_usec;  // wraps around if the clock was set back, ending the ramp
+          weight = progress_usec < rampDurationUsec
+                       ? static_cast<uint32_t>((progress_usec << BLEND_SHIFT) / rampDurationUsec)
+                       : BLEND_ONE;
+          blendChannels(start, action.target, weight, frame);
+          setLight(frame);
+        } while (weight < BLEND_ONE);
 
       } else if constexpr (std::is_same_v<T, LightActionBlink>) {
-        auto [startCW, startWW] = getLight();
+        const auto start = getLight();
         auto start_usec = getCurrentUsecUTC();
         auto end_usec = start_usec + action.blinkDurationMs * 1000;
         while (getCurrentUsecUTC() < end_usec) {
-          setLight(action.highCW, action.highWW);
+          setLight(action.high);
           delay(std::min(static_cast<uint64_t>(action.highDurationMs), (end_usec - getCurrentUsecUTC())/1000));
-          setLight(action.lowCW, action.lowWW);
+          setLight(action.low);
           delay(std::min(static_cast<uint64_t>(action.lowDurationMs), (end_usec - getCurrentUsecUTC())/1000));
         }
-        setLight(startCW, startWW);
+        setLight(start);
       }
     },action);
   }
@@ -575,14 +592,18 @@ void init_characteristics(BLEService *pLightService) {
   pLightProgramsCharacteristic->setCallbacks(new LightProgramsCharacteristicHandler()); // TODO needed?
 
   pLightStateCharacteristic = pLightService->createCharacteristic(lightStateUuid, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_WRITE_NR | BLECharacteristic::PROPERTY_NOTIFY);
-  std::uint8_t byteArray[] = {0x00, 0x00};
-  pLightStateCharacteristic->setValue(byteArray, sizeof(byteArray));
+  LightChannels initialChannels{};
+  pLightStateCharacteristic->setValue(initialChannels.data(), CHANNEL_COUNT);
   pLightStateCharacteristic->setCallbacks(new LightStateCharacteristicHandler());
 
   pTimestampCharacteristic = pLightService->createCharacteristic(timestampUuid, BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_WRITE_NR);
   uint64_t customTimestamp = 0;
   pTimestampCharacteristic->setValue(reinterpret_cast<std::uint8_t*>(&customTimestamp), 8);
   pTimestampCharacteristic->setCallbacks(new TimestampCharacteristicHandler());
+
+  pChannelCountCharacteristic = pLightService->createCharacteristic(channelCountUuid, BLECharacteristic::PROPERTY_READ);
+  uint8_t channelCount = CHANNEL_COUNT;
+  pChannelCountCharacteristic->setValue(&channelCount, 1);
 }
 
 void init_advertising() {
@@ -604,9 +625,10 @@ void init_server(BLEServer *&pLightServer) {
 
 void setup() {
   // using ledc for easier control of frequency so we don't have coil whining
-  ledcSetup(PWM_CHANNEL_CW, PWM_FREQUENCY, PWM_RESOLUTION);
-  ledcAttachPin(CW_PIN, PWM_CHANNEL_CW);
-  ledcAttachPin(WW_PIN, PWM_CHANNEL_WW);
+  for (size_t i = 0; i < CHANNEL_COUNT; ++i) {
+    ledcSetup(i, PWM_FREQUENCY, PWM_RESOLUTION);
+    ledcAttachPin(Fixture::pins[i], i);
+  }
 
   // set env variable to Europe/Berlin (for printing, see https://remotemonitoringsystems.ca/time-zone-abbreviations.php)
   setenv("TZ", "CET-1CEST-2,M3.5.0/02:00:00,M10.5.0/03:00:00", 1);
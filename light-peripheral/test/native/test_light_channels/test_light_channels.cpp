@@ -0,0 +1,114 @@
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "LightChannels.h"
+
+using SingleChannel = std::array<uint8_t, 1>;
+using FullLedcFixture = ChannelSet<0, 1, 2, 3, 4, 5, 12, 13, 14, 15, 16, 17, 18, 19, 21, 22>;
+
+uint8_t blendOne(uint8_t from, uint8_t to, uint32_t weight) {
+  SingleChannel out;
+  blendChannels(SingleChannel{from}, SingleChannel{to}, weight, out);
+  return out[0];
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_blend_endpoints_are_exact() {
+  for (int from = 0; from <= 255; ++from) {
+    for (int to = 0; to <= 255; ++to) {
+      TEST_ASSERT_EQUAL_UINT8(from, blendOne(from, to, 0));
+      TEST_ASSERT_EQUAL_UINT8(to, blendOne(from, to, BLEND_ONE));
+    }
+  }
+}
+
+// Every from/to pair at 257 weights from 0 to BLEND_ONE: the result stays between from and to
+// and never moves away from the target as the weight grows, ramping up as well as down.
+void test_blend_stays_in_range_and_moves_towards_target() {
+  constexpr uint32_t step = BLEND_ONE / 256;
+  for (int from = 0; from <= 255; ++from) {
+    for (int to = 0; to <= 255; ++to) {
+      const int lo = std::min(from, to);
+      const int hi = std::max(from, to);
+      int lastDistance = std::abs(to - from);
+      for (uint32_t weight = 0; weight <= BLEND_ONE; weight += step) {
+        const int value = blendOne(from, to, weight);
+        if (value < lo || value > hi) {
+          char message[64];
+          snprintf(message, sizeof(message), "from %d to %d weight %u gave %d", from, to, weight, value);
+          TEST_FAIL_MESSAGE(message);
+        }
+        const int distance = std::abs(to - value);
+        TEST_ASSERT_TRUE(distance <= lastDistance);
+        lastDistance = distance;
+      }
+    }
+  }
+}
+
+void test_blend_handles_every_channel_independently() {
+  const ChannelsOf<RGBWCCTFixture> from = {0, 255, 100, 10, 200};
+  const ChannelsOf<RGBWCCTFixture> to = {255, 0, 100, 200, 10};
+  ChannelsOf<RGBWCCTFixture> out;
+
+  blendChannels(from, to, BLEND_ONE / 2, out);
+
+  const ChannelsOf<RGBWCCTFixture> expected = {127, 127, 100, 105, 105};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), out.data(), expected.size());
+}
+
+template <typename Set>
+double blendNsPerFrame() {
+  constexpr int frames = 1'000'000;
+  ChannelsOf<Set> from{};
+  ChannelsOf<Set> to{};
+  for (size_t i = 0; i < Set::size; ++i) {
+    to[i] = static_cast<uint8_t>(255 - i);
+  }
+  ChannelsOf<Set> out{};
+  volatile uint8_t sink = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < frames; ++frame) {
+    blendChannels(from, to, static_cast<uint32_t>(frame) & (BLEND_ONE - 1), out);
+    sink = sink + out[frame % Set::size];
+  }
+  const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+
+  const double nsPerFrame = elapsed.count() / frames;
+  char message[96];
+  snprintf(message, sizeof(message), "%2zu channels: %.2f ns/frame, %.2f ns/channel",
+           Set::size, nsPerFrame, nsPerFrame / Set::size);
+  TEST_MESSAGE(message);
+  return nsPerFrame;
+}
+
+// The blend is a single pass over the channels, so the cost per channel must not grow with the channel
+// count (a frame gets linearly, not super-linearly, more expensive). Bounds are loose to stay stable on CI.
+void test_blend_cost_per_channel_does_not_grow() {
+  const double cct = blendNsPerFrame<CCTFixture>() / CCTFixture::size;
+  blendNsPerFrame<RGBFixture>();
+  const double rgbwcct = blendNsPerFrame<RGBWCCTFixture>() / RGBWCCTFixture::size;
+  const double full = blendNsPerFrame<FullLedcFixture>() / FullLedcFixture::size;
+
+  TEST_ASSERT_TRUE(rgbwcct <= 2 * cct);
+  TEST_ASSERT_TRUE(full <= 2 * cct);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_blend_endpoints_are_exact);
+  RUN_TEST(test_blend_stays_in_range_and_moves_towards_target);
+  RUN_TEST(test_blend_handles_every_channel_independently);
+  RUN_TEST(test_blend_cost_per_channel_does_not_grow);
+  return UNITY_END();
+}